@@ -0,0 +1,12 @@
+#include "bench.h"
+
+void benchRecord(volatile bench_timing_t *timing, uint32_t ms) {
+    if(0 == timing->count || ms < timing->minMs) {
+        timing->minMs = ms;
+    }
+    if(ms > timing->maxMs) {
+        timing->maxMs = ms;
+    }
+    timing->totalMs += ms;
+    timing->count++;
+}
@@ -0,0 +1,28 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <inttypes.h>
+
+#define BENCH_STATS_VERSION 2
+
+typedef struct {
+    uint32_t count;
+    uint32_t totalMs;
+    uint32_t minMs;
+    uint32_t maxMs;
+} bench_timing_t;
+
+/*
+    Fixed layout, read out of RAM by the simulator after a scripted run
+ */
+typedef struct {
+    uint16_t version;
+    bench_timing_t cycle;       // BOT to BOT
+    bench_timing_t leg[3];      // arrival to arrival at MID, TOP and BOT
+    bench_timing_t blocked;     // startBlockTimeout() until buttons are released
+    bench_timing_t debounce;    // raw button change until the debounced state follows
+} bench_stats_t;
+
+extern void benchRecord(volatile bench_timing_t *timing, uint32_t ms);
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,44 @@
+#include <stddef.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "config.h"
+
+static uint16_t configCrc(const config_t *config) {
+    const uint8_t *byte = (const uint8_t *) config;
+    uint16_t crc = 0xFFFF;
+    uint8_t i;
+
+    for(i = 0; i < offsetof(config_t, crc); i++) {
+        crc = _crc16_update(crc, byte[i]);
+    }
+    return crc;
+}
+
+void saveConfig(config_t *config) {
+    config->version = CONFIG_VERSION;
+    config->crc = configCrc(config);
+    eeprom_update_block(config, (void *) CONFIG_ADDRESS, sizeof(config_t));
+}
+
+/*
+    Falls back to thresholds stored by older firmware and then to compile
+    time defaults, so a fresh chip comes up ready to run
+ */
+void loadConfig(config_t *config) {
+    eeprom_read_block(config, (const void *) CONFIG_ADDRESS, sizeof(config_t));
+    if(CONFIG_VERSION == config->version && configCrc(config) == config->crc) {
+        return;
+    }
+
+    config->middleThreshold = (int32_t) eeprom_read_dword((uint32_t*) 0);
+    config->topThreshold = (int32_t) eeprom_read_dword((uint32_t*) 4);
+    if(0 <= config->middleThreshold && config->middleThreshold <= config->topThreshold) {
+        saveConfig(config);
+        return;
+    }
+
+    config->version = CONFIG_VERSION;
+    config->middleThreshold = DEFAULT_MIDDLE_THRESHOLD;
+    config->topThreshold = DEFAULT_TOP_THRESHOLD;
+    config->crc = configCrc(config);
+}
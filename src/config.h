@@ -0,0 +1,26 @@
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include <inttypes.h>
+
+#define CONFIG_VERSION 1
+#define CONFIG_ADDRESS 8    // the old layout keeps middle and top thresholds as dwords at 0 and 4
+
+#ifndef DEFAULT_MIDDLE_THRESHOLD
+#define DEFAULT_MIDDLE_THRESHOLD 200
+#endif
+#ifndef DEFAULT_TOP_THRESHOLD
+#define DEFAULT_TOP_THRESHOLD 400
+#endif
+
+typedef struct {
+    uint8_t version;
+    int32_t middleThreshold;
+    int32_t topThreshold;
+    uint16_t crc;           // over everything above
+} config_t;
+
+extern void loadConfig(config_t *config);
+extern void saveConfig(config_t *config);
+
+#endif /* CONFIG_H_ */
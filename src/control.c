@@ -0,0 +1,50 @@
+#include "control.h"
+
+uint16_t speedFromPeriod(uint32_t period, uint32_t timebase) {
+    if(0 == period || period > timebase) {
+        return 0;
+    }
+    return timebase / period;
+}
+
+uint16_t referenceSpeed(const speed_control_t *ctl, int32_t remaining) {
+    uint32_t speed;
+
+    if(remaining <= 0) {
+        return 0;
+    } else if(remaining > 0xFFFF) {
+        return ctl->maxSpeed;
+    }
+    speed = ((uint32_t) remaining * ctl->distanceGain) >> 8;
+    if(speed < ctl->minSpeed) {
+        return ctl->minSpeed;
+    } else if(speed > ctl->maxSpeed) {
+        return ctl->maxSpeed;
+    }
+    return speed;
+}
+
+/*
+    Both terms are products of two 16 bit values, kept unsigned so that any
+    gains fit 32 bits, and stay below 2^24 after the shift
+ */
+uint8_t speedControl(const speed_control_t *ctl, int32_t remaining, uint16_t speed) {
+    uint16_t reference = referenceSpeed(ctl, remaining);
+    int32_t duty;
+
+    if(0 == reference) {
+        return 0;
+    }
+    duty = ((uint32_t) reference * ctl->feedForward) >> 8;
+    if(reference > speed) {
+        duty += ((uint32_t) (reference - speed) * ctl->speedGain) >> 8;
+    } else {
+        duty -= ((uint32_t) (speed - reference) * ctl->speedGain) >> 8;
+    }
+    if(duty < 0) {
+        return 0;
+    } else if(duty > 0xFF) {
+        return 0xFF;
+    }
+    return duty;
+}
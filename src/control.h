@@ -0,0 +1,42 @@
+#ifndef CONTROL_H_
+#define CONTROL_H_
+
+#include <inttypes.h>
+
+/*
+    Default gains, override with -D. Tuned against the plant in
+    sim/controlsim.c to arrive at MIN_SPEED with at most one pulse overshoot
+ */
+#ifndef DISTANCE_GAIN
+#define DISTANCE_GAIN 512 // 2 pulses/s per pulse to go
+#endif
+#ifndef SPEED_GAIN
+#define SPEED_GAIN 64
+#endif
+#ifndef FEED_FORWARD
+#define FEED_FORWARD 160
+#endif
+#ifndef MIN_SPEED
+#define MIN_SPEED 20
+#endif
+#ifndef MAX_SPEED
+#define MAX_SPEED 400
+#endif
+
+/*
+    Gains are Q8.8 fixed point, speeds are in hall pulses per second,
+    distances are in hall pulses and the output is a 0..255 PWM duty.
+ */
+typedef struct {
+    uint16_t distanceGain;  // reference speed per pulse of remaining distance
+    uint16_t speedGain;     // duty per unit of speed error
+    uint16_t feedForward;   // duty per unit of reference speed
+    uint16_t minSpeed;      // creep speed on the last few pulses
+    uint16_t maxSpeed;      // cruise speed far from the target
+} speed_control_t;
+
+extern uint16_t speedFromPeriod(uint32_t period, uint32_t timebase);
+extern uint16_t referenceSpeed(const speed_control_t *ctl, int32_t remaining);
+extern uint8_t speedControl(const speed_control_t *ctl, int32_t remaining, uint16_t speed);
+
+#endif /* CONTROL_H_ */
@@ -0,0 +1,124 @@
+#include "hall.h"
+
+/*
+    Clears statistics and the warning, edge timing is kept
+ */
+void hallReset(volatile hall_monitor_t *hall) {
+    hall->minLow = 0xFFFFFFFF;
+    hall->minHigh = 0xFFFFFFFF;
+    hall->minDuty = 0xFF;
+    hall->maxJitter = 0;
+    hall->badPulses = 0;
+    hall->score = 0;
+    hall->faults = 0;
+    hall->warning = 0;
+}
+
+static void badPulse(volatile hall_monitor_t *hall, uint8_t reason) {
+    if(hall->badPulses < 0xFFFF) {
+        hall->badPulses++;
+    }
+    hall->faults |= reason;
+    hall->score = (hall->score > 0xFF - HALL_BAD_WEIGHT) ? 0xFF : hall->score + HALL_BAD_WEIGHT;
+    if(hall->score >= HALL_WARN_SCORE) {
+        hall->warning |= hall->faults;
+    }
+}
+
+static void goodPulse(volatile hall_monitor_t *hall) {
+    if(hall->score && 0 == --hall->score) {
+        hall->faults = 0;
+    }
+}
+
+/*
+    Judges the period against the line through the two before it, so steady
+    ramps pass, and skips judging while the period keeps moving one way
+ */
+static void judgePeriod(volatile hall_monitor_t *hall, uint32_t period) {
+    int32_t change = (int32_t) period - (int32_t) hall->period;
+    int32_t lastChange = (int32_t) hall->period - (int32_t) hall->prevPeriod;
+    int32_t jitter = change - lastChange;
+
+    goodPulse(hall); //the score decays once per pulse, bad ones add HALL_BAD_WEIGHT back
+    if(hall->settle) {
+        hall->settle--;
+        return;
+    }
+    if((change > 0 && lastChange > 0) || (change < 0 && lastChange < 0)) {
+        return; //ramping
+    }
+    if(jitter < 0) {
+        jitter = -jitter;
+    }
+    if((uint32_t) jitter > hall->maxJitter) {
+        hall->maxJitter = jitter;
+    }
+    if(((uint32_t) jitter << 8) > period * HALL_MAX_JITTER) {
+        badPulse(hall, HALL_WARN_JITTER);
+    }
+}
+
+static void hallFalling(volatile hall_monitor_t *hall, uint32_t now) {
+    uint32_t period = now - hall->lastFall;
+
+    hall->high = now - hall->lastRise;
+    if(period < HALL_QUALITY_PERIOD && hall->period < HALL_QUALITY_PERIOD && hall->prevPeriod < HALL_QUALITY_PERIOD) {
+        if(hall->high < hall->minHigh) {
+            hall->minHigh = hall->high;
+        }
+        judgePeriod(hall, period);
+    }
+    hall->prevPeriod = hall->period;
+    hall->period = period;
+    hall->lastFall = now;
+}
+
+static void hallRising(volatile hall_monitor_t *hall, uint32_t now) {
+    hall->low = now - hall->lastFall;
+    if(hall->period < HALL_QUALITY_PERIOD && hall->low < HALL_QUALITY_PERIOD) {
+        if(hall->low < hall->minLow) {
+            hall->minLow = hall->low;
+        }
+        if((hall->low << 8) < hall->period * hall->minDuty) {
+            hall->minDuty = (hall->low << 8) / hall->period; //divides only on a new minimum
+        }
+        if(hall->low < HALL_MIN_WIDTH) {
+            badPulse(hall, HALL_WARN_NARROW);
+        } else if((hall->low << 8) < hall->period * HALL_MIN_DUTY) {
+            badPulse(hall, HALL_WARN_DUTY);
+        }
+    }
+    hall->lastRise = now;
+}
+
+/*
+    Handles an edge given the sensor level read in the interrupt. The same
+    level twice means the edge in between was shorter than the interrupt
+    latency, the missed half of the pulse is accounted for and judged bad,
+    and the INT0 flag the missed edge left pending is cleared so the pulse
+    is not counted again. Returns 1 when a magnet pass has to be counted.
+ */
+uint8_t hallEdge(volatile hall_monitor_t *hall, uint8_t magnet, uint32_t now) {
+    if(magnet == hall->magnet) {
+        GIFR = _BV(INTF0);
+        if(magnet) {
+            hall->lastRise = now;   //missed the gap
+            hallFalling(hall, now);
+        } else {
+            hallFalling(hall, now); //missed the whole magnet pulse
+            hall->low = 0;
+            hall->lastRise = now;
+        }
+        badPulse(hall, HALL_WARN_NARROW);
+        return 1;
+    }
+
+    hall->magnet = magnet;
+    if(magnet) {
+        hallFalling(hall, now);
+        return 1;
+    }
+    hallRising(hall, now);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef HALL_H_
+#define HALL_H_
+
+#include <inttypes.h>
+#include <avr/io.h>
+
+/*
+    Widths and periods are in timebase ticks (0.5us at 16MHz), duty and
+    jitter limits are Q0.8 fractions of the pulse period.
+ */
+#ifndef HALL_QUALITY_PERIOD
+#define HALL_QUALITY_PERIOD 40000   // judge only pulses faster than 50 per second
+#endif
+#ifndef HALL_MIN_WIDTH
+#define HALL_MIN_WIDTH 100          // 50us, shorter magnet pulses risk being missed
+#endif
+#ifndef HALL_MIN_DUTY
+#define HALL_MIN_DUTY 26            // magnet pulse under ~10% of the period
+#endif
+#ifndef HALL_MAX_JITTER
+#define HALL_MAX_JITTER 64          // period off its linear trend by over ~25%
+#endif
+#ifndef HALL_SETTLE_PULSES
+#define HALL_SETTLE_PULSES 8        // pulses without jitter judging after the relay switches
+#endif
+#ifndef HALL_BAD_WEIGHT
+#define HALL_BAD_WEIGHT 8           // score added per bad pulse, every judged pulse takes one off
+#endif
+#ifndef HALL_WARN_SCORE
+#define HALL_WARN_SCORE 64          // roughly one bad pulse in nine, sustained
+#endif
+
+#define HALL_WARN_NARROW _BV(0)
+#define HALL_WARN_DUTY _BV(1)
+#define HALL_WARN_JITTER _BV(2)
+
+typedef struct {
+    uint32_t lastFall;
+    uint32_t lastRise;
+    uint32_t period;    // falling edge to falling edge
+    uint32_t prevPeriod;
+    uint32_t low;       // magnet over the sensor
+    uint32_t high;      // gap between magnets
+    uint32_t minLow;
+    uint32_t minHigh;
+    uint8_t minDuty;    // Q0.8 fraction of the period
+    uint32_t maxJitter;
+    uint16_t badPulses; // lifetime total, for the record only
+    uint8_t score;
+    uint8_t faults;     // reasons behind the current score
+    uint8_t settle;
+    uint8_t magnet;     // level of the last edge handled
+    uint8_t warning;
+} hall_monitor_t;
+
+extern void hallReset(volatile hall_monitor_t *hall);
+extern uint8_t hallEdge(volatile hall_monitor_t *hall, uint8_t magnet, uint32_t now);
+
+#endif /* HALL_H_ */
@@ -7,6 +7,10 @@
 #include <avr/sleep.h>
 #include <avr/eeprom.h>
 #include "debounce.h"
+#include "control.h"
+#include "hall.h"
+#include "bench.h"
+#include "config.h"
 
 
 #define UP_BUTTON PB1
@@ -25,6 +29,7 @@
 #define MODE_PULL_DOWN PC5
 
 #define HALL_SENSE PD2
+#define HALL_COUNT PD4 //T0, wired to the hall sensor in parallel with HALL_SENSE
 #define SPEED_SELECT PD5
 #define DOWN_SWITCH PD6
 #define UP_SWITCH PD7
@@ -41,6 +46,38 @@
 #define DIRECTION_UP 1
 #define DIRECTION_DOWN 2
 
+#ifndef CLOSED_LOOP
+#define CLOSED_LOOP 0
+#endif
+#ifndef BENCHMARK
+#define BENCHMARK 0
+#endif
+
+#define SPEED_REFERENCE PB3 //OC2, filtered to the VFD analog input in closed loop mode
+
+#define TIMEBASE_HZ (F_CPU / 8) //timer1 runs free at clk/8
+#define CONTROL_RATE_HZ 200
+#define CONTROL_TICK (TIMEBASE_HZ / CONTROL_RATE_HZ)
+#define TICKS_PER_MS (TIMEBASE_HZ / 1000)
+#define DEBOUNCE_DIVIDER 3 //control ticks per debounce tick, ~67Hz
+
+#define BLOCK_TIMEOUT_TICKS 32 //timer1 overflows, ~1s
+#define MIDDLE_POSITION_TIMEOUT_TICKS 128 //~4s
+
+/*
+    RELAY_DROP_LEAD is the relay and VFD reaction time measured on the jig,
+    in timer1 ticks of 0.5us. While it is 0 compare B is never armed and the
+    relay drops in INT0 on the target pulse itself. A compare predicted from
+    the last period would fire early while the jig decelerates.
+ */
+#define RELAY_DROP_PULSES 4 //how many pulses ahead the relay drop gets scheduled
+#ifndef RELAY_DROP_LEAD
+#define RELAY_DROP_LEAD 0
+#endif
+
+#define SPEED_REF_SLOW 64
+#define SPEED_REF_FULL 255
+
 volatile switch_t progModeTumbler = {0xFF, FALSE, FALSE};
 volatile switch_t programButton = {0xFF, FALSE, FALSE};
 volatile switch_t upButton = {0xFF, FALSE, FALSE};
@@ -64,6 +101,32 @@ uint8_t lastTumblerState = 0;
 
 uint8_t middlePositionTimeout = FALSE;
 volatile int32_t topThreshold, middleThreshold, bottomThreshold, currThreshold;
+config_t config;
+
+volatile uint16_t timebaseHigh = 0;
+volatile uint8_t timeoutTicks = 0;
+volatile uint8_t dropSwitch = 0;
+volatile uint8_t debounceDivider = DEBOUNCE_DIVIDER;
+volatile uint8_t hallPulses = 0; //falling edges seen by INT0, checked against timer0
+volatile uint16_t lostPulses = 0;
+volatile uint16_t extraPulses = 0;
+int8_t lastMissedPulses = 0; //difference seen on the previous cross-check pass
+volatile hall_monitor_t hall;
+
+//not const so that gains can be tuned in a simulator without rebuilding
+speed_control_t speedControlGains = {DISTANCE_GAIN, SPEED_GAIN, FEED_FORWARD, MIN_SPEED, MAX_SPEED};
+volatile uint8_t openLoopReference = SPEED_REF_SLOW;
+volatile uint16_t controlCost = 0; //timer1 ticks, 8 cpu cycles each
+volatile uint16_t controlCostMax = 0;
+
+#if BENCHMARK
+volatile bench_stats_t benchStats = {.version = BENCH_STATS_VERSION};
+volatile uint32_t benchLastArrival = 0;
+volatile uint32_t benchLastCycle = 0;
+volatile uint32_t benchBlockStart = 0;
+volatile uint32_t upButtonEdge = 0;
+volatile uint32_t downButtonEdge = 0;
+#endif
 
 static inline void setupGPIO() {
     DDRC |= _BV(LED_MID) | _BV(LED_TOP) | _BV(LED_BOT);
@@ -83,17 +146,88 @@ static inline void setupGPIO() {
     
     modePullState = 1;
     
-    DDRD &= ~(_BV(HALL_SENSE));
-    PORTD |= _BV(HALL_SENSE);
+    DDRD &= ~(_BV(HALL_SENSE) | _BV(HALL_COUNT));
+    PORTD |= _BV(HALL_SENSE) | _BV(HALL_COUNT);
+
+#if CLOSED_LOOP
+    DDRB |= _BV(SPEED_REFERENCE);
+    PORTB &= ~_BV(SPEED_REFERENCE);
+#endif
 }
 
 static inline void speedFull() {
+#if CLOSED_LOOP
+    openLoopReference = SPEED_REF_FULL;
+#else
     PORTD |= _BV(SPEED_SELECT);
+#endif
 }
 
 static inline void speedSlow() {
+#if CLOSED_LOOP
+    openLoopReference = SPEED_REF_SLOW;
+#else
     PORTD &= ~_BV(SPEED_SELECT);
+#endif
+}
+
+/*
+    32 bit timer1 time, call with interrupts disabled
+ */
+static inline uint32_t timestamp() {
+    uint16_t low = TCNT1;
+    uint16_t high = timebaseHigh;
+    if((TIFR & _BV(TOV1)) && low < 0x8000) {
+        high++;
+    }
+    return ((uint32_t) high << 16) | low;
+}
+
+#if BENCHMARK
+static inline uint32_t msSince(uint32_t since) {
+    return (timestamp() - since) / TICKS_PER_MS;
+}
+
+/*
+    Called with interrupts disabled when a leg ends at the given position
+ */
+static inline void benchArrival(uint8_t position) {
+    uint8_t leg = (POS_MID == position) ? 0 : (POS_TOP == position) ? 1 : 2;
+
+    if(benchLastArrival) {
+        benchRecord(&benchStats.leg[leg], msSince(benchLastArrival));
+    }
+    benchLastArrival = timestamp();
+    if(POS_BOT == position) {
+        if(benchLastCycle) {
+            benchRecord(&benchStats.cycle, msSince(benchLastCycle));
+        }
+        benchLastCycle = benchLastArrival;
+    }
+}
+
+/*
+    Called after debouncing with the pressed state from before it, times from
+    the raw button input first disagreeing with the debounced state until the
+    debounced state follows. Servicing is left out, it waits while blocked.
+ */
+static inline void benchButtonSample(volatile switch_t *button, volatile uint32_t *edge, uint8_t wasPressed) {
+    uint8_t rawPressed = (0 == (button->pinBuffer & 1));
+
+    if(button->pressed != wasPressed) {
+        if(*edge) {
+            benchRecord(&benchStats.debounce, msSince(*edge));
+        }
+        *edge = 0;
+    } else if(rawPressed != button->pressed) {
+        if(0 == *edge) {
+            *edge = timestamp();
+        }
+    } else if(0 == button->pinBuffer || 0xFF == button->pinBuffer) {
+        *edge = 0; //bounced back without a change
+    }
 }
+#endif
 
 static inline void ledOn(uint8_t led) {
     PORTC |= _BV(led);
@@ -138,28 +272,35 @@ static inline void modePullUp(){
 }
 
 static inline void closeSwitch(uint8_t sw) {
+    if(!(PORTD & _BV(sw))) {
+        hall.settle = HALL_SETTLE_PULSES;
+    }
     PORTD |= _BV(sw);
 }
 
 static inline void openSwitch(uint8_t sw) {
+    if(PORTD & _BV(sw)) {
+        hall.settle = HALL_SETTLE_PULSES;
+    }
     PORTD &= ~_BV(sw);
 }
 
 static inline void startBlockTimeout() {
     block=TRUE;
-    TIMSK |= _BV(TOIE1);
-    TCCR1B |= _BV(CS12) ;
+    timeoutTicks = BLOCK_TIMEOUT_TICKS;
+#if BENCHMARK
+    benchBlockStart = timestamp();
+#endif
 }
 
 static inline void startMiddlePositionTimeout() {
     middlePositionTimeout=TRUE;
-    TIMSK |= _BV(TOIE1);
-    TCCR1B |= _BV(CS12) | _BV(CS10);
+    timeoutTicks = MIDDLE_POSITION_TIMEOUT_TICKS;
     ledOff(LED_BOT);
 }
 
 void stopMiddlePositionTimeout() {
-    TCCR1B = 0;
+    timeoutTicks = 0;
     middlePositionTimeout = FALSE;
 }
 
@@ -173,24 +314,44 @@ uint8_t getNextPosition() {
     }
 }
 
+int32_t thresholdFor(uint8_t position) {
+    if(POS_MID == position) {
+        return middleThreshold;
+    } else if(POS_TOP == position) {
+        return topThreshold;
+    }
+    return bottomThreshold;
+}
+
 void setUpNextPosition() {
     ledOff(currPosition);
     currPosition = nextPosition;
     ledOn(currPosition);
     nextPosition = getNextPosition();
 
-    if(POS_BOT == nextPosition) {
-        currThreshold = bottomThreshold;
-        speedFull();
-    } else if(POS_MID == nextPosition) {
-        currThreshold = middleThreshold;
+    currThreshold = thresholdFor(nextPosition);
+    if(POS_MID == nextPosition) {
         speedSlow();
-    } else if(POS_TOP == nextPosition) {
-        currThreshold = topThreshold;
+    } else {
         speedFull();
     }
 }
 
+static inline void cancelRelayDrop() {
+    TIMSK &= ~_BV(OCIE1B);
+}
+
+void arriveAtNextPosition(uint8_t sw) {
+    cancelRelayDrop();
+#if BENCHMARK
+    benchArrival(nextPosition);
+#endif
+    openSwitch(sw);
+    startBlockTimeout();
+    blinkRate = BLINK_SLOW;
+    setUpNextPosition();
+}
+
 static inline uint8_t canGoUp() {
     return MODE_MANUAL == mode ||
     	   MODE_PROGRAM == mode ||
@@ -216,6 +377,7 @@ void onUpButtonPressed() {
 }
 
 void onUpButtonReleased() {
+    cancelRelayDrop();
     openSwitch(UP_SWITCH);
     blinkRate = BLINK_SLOW;
 }
@@ -229,11 +391,21 @@ void onDownButtonPressed() {
 }
 
 void onDownButtonReleased() {
+    cancelRelayDrop();
     openSwitch(DOWN_SWITCH);
     blinkRate = BLINK_SLOW;
 }
 
+void onHallWarningCleared() {
+    ATOMIC_BLOCK(ATOMIC_FORCEON) {
+        hallReset(&hall);
+    }
+    allLedsOff();
+}
+
 void onProgramButtonPressed() {
+    uint8_t save = FALSE;
+
     if(MODE_PROGRAM == mode) {
         ATOMIC_BLOCK(ATOMIC_FORCEON) {
             currPosition = nextPosition;
@@ -245,25 +417,31 @@ void onProgramButtonPressed() {
                 clicks = 0;
             } else if(POS_MID == currPosition) {
                 middleThreshold = (clicks > bottomThreshold) ? clicks : bottomThreshold;
-                eeprom_write_dword((uint32_t*) 0, middleThreshold);
+                save = TRUE;
             } else if(POS_TOP == currPosition) {
             	topThreshold = (clicks > middleThreshold) ? clicks : middleThreshold;
-                eeprom_write_dword((uint32_t*) 4, topThreshold);
+                save = TRUE;
                 block = TRUE;
             }
         }
+        if(save) { //eeprom write takes milliseconds, keep hall pulses counting meanwhile
+            config.middleThreshold = middleThreshold;
+            config.topThreshold = topThreshold;
+            saveConfig(&config);
+        }
     }
 }
 
 static inline void changeMode(uint8_t newMode) {
     allLedsOff();
     stopMiddlePositionTimeout();
+    cancelRelayDrop();
     
     if(MODE_RUN == newMode) {
 //        currPosition = POS_TOP;
 //        nextPosition = POS_BOT;
         ledOn(currPosition);
-        currThreshold = bottomThreshold;
+        currThreshold = thresholdFor(nextPosition);
         block = FALSE;
         if(POS_TOP == currPosition || POS_MID == currPosition) {
         	speedFull();
@@ -310,33 +488,78 @@ static inline void serviceTumbler(volatile switch_t *tumbler) {
 } 
 
 /*
-    Timer1 overflow interrupt releases buttons to user
+    Timer1 overflow interrupt extends the timebase and releases buttons to user on timeout
  */
 ISR(TIMER1_OVF_vect) {
-    if(block) {
-        block=FALSE;
+    timebaseHigh++;
+    if(timeoutTicks && 0 == --timeoutTicks) {
+        if(block) {
+            block=FALSE;
+#if BENCHMARK
+            benchRecord(&benchStats.blocked, msSince(benchBlockStart));
+#endif
+        }
+        if(middlePositionTimeout) {
+            middlePositionTimeout = FALSE;
+            setUpNextPosition();
+        }
+    }
+}
+
+#if CLOSED_LOOP
+/*
+    Called with interrupts disabled, takes a snapshot of the counting state
+    and enables interrupts again for the arithmetic so INT0 is not delayed.
+    Only the control law itself is timed into controlCost, with interrupts
+    off so that nested interrupts are not counted and TCNT1 reads stay atomic
+ */
+static inline void updateSpeedReference() {
+    uint32_t period = hall.period;
+    uint32_t sinceEdge = timestamp() - hall.lastFall;
+    int32_t remaining;
+    uint16_t speed, start;
+    uint8_t duty;
+
+    if(MODE_RUN != mode) {
+        OCR2 = openLoopReference;
+        return;
     }
-    if(middlePositionTimeout) {
-        middlePositionTimeout = FALSE;
-        setUpNextPosition();
+    if(POS_BOT != nextPosition && (PORTD & _BV(UP_SWITCH))) {
+        remaining = currThreshold - clicks;
+    } else if(POS_BOT == nextPosition && (PORTD & _BV(DOWN_SWITCH))) {
+        remaining = clicks - currThreshold;
+    } else {
+        OCR2 = openLoopReference; //not heading for nextPosition, manual positioning
+        return;
+    }
+    sei();
+    if(sinceEdge > period) {
+        period = sinceEdge; //no edge for longer than the last period, we are slowing down
+    }
+    speed = speedFromPeriod(period, TIMEBASE_HZ);
+    ATOMIC_BLOCK(ATOMIC_FORCEON) {
+        start = TCNT1;
+        duty = speedControl(&speedControlGains, remaining, speed);
+        controlCost = TCNT1 - start;
+    }
+    OCR2 = duty;
+    if(controlCost > controlCostMax) {
+        controlCostMax = controlCost;
     }
-    TCCR1B = 0;
 }
+#endif
 
 
 uint8_t clicksOverMiddleThreshold = 0;
 uint8_t clicksOverTopThreshold = 0;
 uint8_t clicksBelowBottomThreshold = 0;
 
-/*
-    External interrupt gets executed on magnet pass over the Hall sensor
- */
-ISR(INT0_vect) {
+static inline void countClicks(int8_t pulses) {
     if(DIRECTION_UP == lastDirection) {
-        clicks++;
+        clicks += pulses;
     }
     if(DIRECTION_DOWN == lastDirection) {
-        clicks--;
+        clicks -= pulses;
     }
     clicksOverMiddleThreshold = (clicks >= middleThreshold);
     clicksOverTopThreshold = (clicks >= topThreshold);
@@ -344,10 +567,88 @@ ISR(INT0_vect) {
 }
 
 /*
-    Timer0 overflow interrupt takes care of button debouncing and led blinking
+    Predicts from the hall period when the running relay has to drop and
+    arms timer1 compare B for that moment, refined on every pulse
+ */
+static inline void scheduleRelayDrop(uint32_t now) {
+    int32_t remaining;
+    uint32_t delay;
+    uint16_t elapsed;
+
+    cancelRelayDrop(); //whatever was predicted on the previous pulse is stale now
+    if(MODE_RUN != mode || block) {
+        return;
+    }
+    if(POS_BOT != nextPosition && (PORTD & _BV(UP_SWITCH))) {
+        remaining = currThreshold - clicks;
+        dropSwitch = UP_SWITCH;
+    } else if(POS_BOT == nextPosition && (PORTD & _BV(DOWN_SWITCH))) {
+        remaining = clicks - currThreshold;
+        dropSwitch = DOWN_SWITCH;
+    } else {
+        return;
+    }
+    if(remaining <= 0) {
+        arriveAtNextPosition(dropSwitch);
+        return;
+    }
+    if(0 == RELAY_DROP_LEAD) {
+        return; //nothing to lead by, INT0 drops on the target pulse
+    }
+    if(remaining > RELAY_DROP_PULSES || 0 == hall.period || hall.period > 0x7FFF) {
+        return; //too far or too slow to predict, the next pulse decides
+    }
+
+    delay = remaining * hall.period;
+    delay = (delay > RELAY_DROP_LEAD) ? delay - RELAY_DROP_LEAD : 0;
+    if(delay > 0x7FFF) {
+        return;
+    }
+    elapsed = TCNT1 - (uint16_t) now;
+    if(delay <= elapsed + 16UL) {
+        arriveAtNextPosition(dropSwitch); //too close to arm the compare
+        return;
+    }
+    OCR1B = now + delay;
+    TIFR = _BV(OCF1B);
+    TIMSK |= _BV(OCIE1B);
+}
+
+/*
+    Timer1 compare B interrupt drops the relay at the scheduled moment
+ */
+ISR(TIMER1_COMPB_vect) {
+    cancelRelayDrop();
+    if(!block && (PORTD & _BV(dropSwitch))) {
+        arriveAtNextPosition(dropSwitch);
+    }
+}
+
+/*
+    External interrupt gets executed on both edges of the Hall sensor,
+    a magnet pass is counted on the falling edge or when it was too short
+    for the level to be seen
+ */
+ISR(INT0_vect) {
+    uint8_t magnet = !(PIND & _BV(HALL_SENSE)); //before anything else, as close to the edge as it gets
+    uint32_t now = timestamp();
+
+    if(hallEdge(&hall, magnet, now)) {
+        hallPulses++;
+        countClicks(1);
+        scheduleRelayDrop(now);
+    }
+}
+
+/*
+    Button debouncing and led blinking
  */
-ISR(TIMER0_OVF_vect) {
-	sei();
+static inline void debounceTick() {
+#if BENCHMARK
+    uint8_t upWasPressed = upButton.pressed;
+    uint8_t downWasPressed = downButton.pressed;
+#endif
+
     debounce(&progModeTumbler, &PINC, MODE_TUMBLER);
 
     if(!downButton.pressed) {
@@ -362,27 +663,114 @@ ISR(TIMER0_OVF_vect) {
         debounce(&programButton, &PINC, PROGRAM_BUTTON);
     }
 
+#if BENCHMARK
+    ATOMIC_BLOCK(ATOMIC_FORCEON) {
+        benchButtonSample(&upButton, &upButtonEdge, upWasPressed);
+        benchButtonSample(&downButton, &downButtonEdge, downWasPressed);
+    }
+#endif
+
     if((MODE_PROGRAM == mode || MODE_RUN == mode) && !block) {
         if(0 == blinkCounter--) {
             toggleLed(nextPosition);
             blinkCounter = blinkRate;
+            if(MODE_RUN == mode) {
+                if(hall.warning && BLINK_SLOW == blinkRate && (PORTC & _BV(nextPosition))) {
+                    ledOff(currPosition); //idle with current and next position alternating, hall sensor is degrading
+                } else {
+                    ledOn(currPosition);
+                }
+            }
         }
+    } else if(MODE_MANUAL == mode && hall.warning) {
+        if(0 == blinkCounter--) { //blinking leds in manual mode tell why the hall sensor warning was raised
+            if(hall.warning & HALL_WARN_NARROW) {
+                toggleLed(LED_TOP);
+            }
+            if(hall.warning & HALL_WARN_DUTY) {
+                toggleLed(LED_MID);
+            }
+            if(hall.warning & HALL_WARN_JITTER) {
+                toggleLed(LED_BOT);
+            }
+            blinkCounter = BLINK_FAST;
+        }
+    }
+}
+
+/*
+    Timer1 compare A interrupt is the system tick, it runs the speed control
+    loop at CONTROL_RATE_HZ and debouncing every DEBOUNCE_DIVIDER ticks
+ */
+ISR(TIMER1_COMPA_vect) {
+    OCR1A += CONTROL_TICK;
+
+#if CLOSED_LOOP
+    updateSpeedReference();
+#endif
+
+    if(0 == --debounceDivider) {
+        debounceDivider = DEBOUNCE_DIVIDER;
+        sei();
+        debounceTick();
     }
+}
 
+/*
+    Compares the hall pulses counted by timer0 in hardware with those counted
+    by INT0 and corrects clicks by the difference. The counter is read
+    between two looks at the INT0 flag, and a pass with an edge pending is
+    left to INT0. A difference has to show on two passes in a row before
+    clicks is touched, so one caught mid-edge is never booked.
+ */
+static inline void crossCheckPulses() {
+    uint8_t pending, count;
+    int8_t missed = 0;
+
+    ATOMIC_BLOCK(ATOMIC_FORCEON) {
+        do {
+            pending = GIFR & _BV(INTF0);
+            count = TCNT0;
+        } while(pending != (GIFR & _BV(INTF0)));
+        if(!pending) {
+            missed = (int8_t) (uint8_t) (count - hallPulses);
+        }
+        if(missed && missed == lastMissedPulses) {
+            if(missed > 0) {
+                lostPulses += missed;
+            } else {
+                extraPulses -= missed;
+            }
+            hallPulses += missed;
+            countClicks(missed);
+            missed = 0;
+        }
+        lastMissedPulses = missed;
+    }
 }
 
 int main (void) {
     setupGPIO();
     blinkHello();
     
-    TIMSK |= _BV(TOIE0);//timer0 overflow interrupt enable
-    TCCR0 |= _BV(CS02) | _BV(CS00);  // clk/1024
+    TCCR0 |= _BV(CS02) | _BV(CS01);  // timer0 counts falling edges on T0
+
+    TIMSK |= _BV(TOIE1);//timer1 overflow interrupt enable
+    TCCR1B |= _BV(CS11); // clk/8, free running timebase
+    OCR1A = CONTROL_TICK;
+    TIMSK |= _BV(OCIE1A);//timer1 compare A interrupt enable
+#if CLOSED_LOOP
+    TCCR2 |= _BV(WGM21) | _BV(WGM20) | _BV(COM21) | _BV(CS21); //fast PWM on OC2, clk/8
+#endif
 
-    MCUCR |= _BV(ISC01); //falling edge
+    MCUCR |= _BV(ISC00); //any edge
     GICR |= _BV(INT0); //int0 external interrupt enable
 
-    middleThreshold = (int32_t) eeprom_read_dword((uint32_t*) 0);
-    topThreshold = (int32_t) eeprom_read_dword((uint32_t*) 4);
+    hallReset(&hall);
+    hall.magnet = !(PIND & _BV(HALL_SENSE));
+    loadConfig(&config);
+    middleThreshold = config.middleThreshold;
+    topThreshold = config.topThreshold;
     clicks = topThreshold;
     speedSlow();
     
@@ -390,9 +778,12 @@ int main (void) {
     ledOn(currPosition);
     
     while(1){
+        crossCheckPulses();
         serviceTumbler(&progModeTumbler);
         if(MODE_PROGRAM == mode) {
             serviceButton(&programButton, onProgramButtonPressed, 0);
+        } else if(MODE_MANUAL == mode) {
+            serviceButton(&programButton, onHallWarningCleared, 0);
         }
 
         if(!block) {
@@ -401,21 +792,23 @@ int main (void) {
             
             if(MODE_RUN == mode) {
                 if(upButton.pressed) {
-                    stopMiddlePositionTimeout();
-					if((POS_MID == nextPosition && clicksOverMiddleThreshold) || (POS_TOP == nextPosition && clicksOverTopThreshold)) {
-						openSwitch(UP_SWITCH);
-						startBlockTimeout();
-						blinkRate = BLINK_SLOW;
-						setUpNextPosition();
-					}
+                    ATOMIC_BLOCK(ATOMIC_FORCEON) { //the scheduled relay drop may have arrived already
+                        if(!block) {
+                            stopMiddlePositionTimeout();
+                            if((POS_MID == nextPosition && clicksOverMiddleThreshold) || (POS_TOP == nextPosition && clicksOverTopThreshold)) {
+                                arriveAtNextPosition(UP_SWITCH);
+                            }
+                        }
+                    }
                 } else if(downButton.pressed) {
-                    stopMiddlePositionTimeout();
-					if(POS_BOT == nextPosition && clicksBelowBottomThreshold) {
-						openSwitch(DOWN_SWITCH);
-						startBlockTimeout();
-						blinkRate = BLINK_SLOW;
-						setUpNextPosition();
-					}
+                    ATOMIC_BLOCK(ATOMIC_FORCEON) {
+                        if(!block) {
+                            stopMiddlePositionTimeout();
+                            if(POS_BOT == nextPosition && clicksBelowBottomThreshold) {
+                                arriveAtNextPosition(DOWN_SWITCH);
+                            }
+                        }
+                    }
                 }
             } else if(MODE_PROGRAM == mode) {
                 if(isGoingBelowPreviousThreshold()) {
@@ -0,0 +1,265 @@
+/*
+    simavr driver for the cycle throughput benchmark
+
+    Loads a firmware built with BENCHMARK=1, puts the mode tumbler in run
+    position and plays an operator working the jig through TOP->BOT->MID->TOP
+    legs, with a pulley model turning relay and speed outputs into hall
+    pulses. After the requested number of BOT to BOT cycles benchStats is
+    read from RAM and written as JSON.
+
+    The firmware cross-checks INT0 against timer0 counting T0 in hardware.
+    The driver watches TCNT0 and reports in the JSON whether the simulated
+    core counted T0 at all, without it the cross-check has nothing to go on.
+
+    usage: bench <firmware.elf> <benchStats address> <result.json> [label [cycles [seed]]]
+
+    The benchStats address is the one avr-nm prints, the Makefile passes it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "avr_ioport.h"
+#include "bench.h"
+
+#define F_CPU 16000000UL
+#define STEP_US 20
+#define STEP_CYCLES (F_CPU / 1000000 * STEP_US)
+
+/*
+    atmega8 data space addresses, the I/O addresses of the datasheet register
+    summary plus 0x20. simavr keeps its register map in the core and does not
+    export it, so these have to follow the part used here.
+ */
+#define DDRB_ADDRESS (0x17 + 0x20)
+#define PORTC_ADDRESS (0x15 + 0x20)
+#define PORTD_ADDRESS (0x12 + 0x20)
+#define OCR2_ADDRESS (0x23 + 0x20)
+#define TCNT0_ADDRESS (0x32 + 0x20)
+
+/* pins as wired in main.c */
+#define DOWN_BUTTON 0   // PB0
+#define UP_BUTTON 1     // PB1
+#define SPEED_REFERENCE 3 // PB3
+#define PROGRAM_BUTTON 2 // PC2
+#define MODE_TUMBLER 3  // PC3
+#define HALL_SENSE 2    // PD2
+#define HALL_COUNT 4    // PD4
+#define SPEED_SELECT 5  // PD5
+#define DOWN_SWITCH 6   // PD6
+#define UP_SWITCH 7     // PD7
+
+/* pulley model */
+#define FULL_SPEED 400.0    // pulses/s with SPEED_SELECT high or full reference
+#define SLOW_SPEED 80.0
+#define RAMP_TAU 0.15       // s
+#define COAST_TAU 0.08      // s, after the relay opens
+#define MAGNET_SHARE 0.3    // part of a pulse period the magnet is over the sensor
+
+/* operator model, ms */
+#define STARTUP_MS 1500     // tumbler settling before the first press
+#define REACTION_MS 250     // press to release after the relay drops
+#define JITTER_PERCENT 20
+#define LEG_TIMEOUT_MS 60000
+static const uint32_t workMs[3] = {2000, 2000, 3000}; // at MID, TOP, BOT
+
+enum { LEG_TO_MID, LEG_TO_TOP, LEG_TO_BOT };
+enum { OPERATOR_WORKING, OPERATOR_HOLDING, OPERATOR_RELEASING };
+
+static uint32_t seed;
+
+static uint32_t randomMs(uint32_t ms) {
+    uint32_t spread = ms * JITTER_PERCENT / 100;
+
+    seed = seed * 1103515245 + 12345;
+    if(0 == spread) {
+        return ms;
+    }
+    return ms - spread + (seed >> 8) % (2 * spread + 1);
+}
+
+static uint32_t readU32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void writeTiming(FILE *out, const char *name, const uint8_t *p, int last) {
+    uint32_t count = readU32(p);
+    uint32_t total = readU32(p + 4);
+
+    fprintf(out, "  \"%s\": {\"count\": %" PRIu32 ", \"total_ms\": %" PRIu32 ", \"avg_ms\": %.1f, \"min_ms\": %" PRIu32 ", \"max_ms\": %" PRIu32 "}%s\n",
+            name, count, total, count ? (double) total / count : 0.0, readU32(p + 8), readU32(p + 12), last ? "" : ",");
+}
+
+static void setPin(avr_t *avr, char port, int pin, uint8_t *state, uint8_t value) {
+    if(*state != value) {
+        avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), pin), value);
+        *state = value;
+    }
+}
+
+int main(int argc, char **argv) {
+    elf_firmware_t firmware = {{0}};
+    avr_t *avr;
+    const uint8_t *stats;
+    uint32_t statsAddress;
+    uint32_t cycles = 20, firstSeed;
+    const char *label = "";
+    FILE *out;
+
+    double position = 0.5, speed = 0, direction = 0;
+    uint8_t hallLevel = 0xFF, countLevel = 0xFF, tumblerLevel = 0xFF, upLevel = 0xFF, downLevel = 0xFF, programLevel = 0xFF;
+    uint8_t leg = LEG_TO_BOT, operator = OPERATOR_WORKING, relaySeen = 0;
+    uint64_t nextStep = STEP_CYCLES;
+    uint32_t now = 0, wakeMs = STARTUP_MS, legStartMs = 0;
+    uint32_t pulsesDriven = 0, countChanges = 0;
+    uint8_t lastCount;
+    int state = cpu_Running;
+
+    if(argc < 4) {
+        fprintf(stderr, "usage: %s <firmware.elf> <benchStats address> <result.json> [label [cycles [seed]]]\n", argv[0]);
+        return 2;
+    }
+    statsAddress = strtoul(argv[2], 0, 16) & 0xFFFF; // avr-nm prints data addresses offset by 0x800000
+    if(argc > 4) {
+        label = argv[4];
+    }
+    if(argc > 5) {
+        cycles = strtoul(argv[5], 0, 10);
+    }
+    seed = firstSeed = (argc > 6) ? strtoul(argv[6], 0, 10) : 1;
+
+    if(elf_read_firmware(argv[1], &firmware)) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    avr = avr_make_mcu_by_name("atmega8");
+    if(!avr) {
+        fprintf(stderr, "simavr has no atmega8 core\n");
+        return 1;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->frequency = F_CPU;
+    stats = avr->data + statsAddress;
+    lastCount = avr->data[TCNT0_ADDRESS];
+
+    setPin(avr, 'C', PROGRAM_BUTTON, &programLevel, 1);
+    setPin(avr, 'B', UP_BUTTON, &upLevel, 1);
+    setPin(avr, 'B', DOWN_BUTTON, &downLevel, 1);
+
+    while(cpu_Done != state && cpu_Crashed != state) {
+        uint8_t portd, closedLoop, upRelay, downRelay;
+        double target, magnet;
+
+        state = avr_run(avr);
+        if(avr->cycle < nextStep) {
+            continue;
+        }
+        nextStep += STEP_CYCLES;
+        now = avr->cycle / (F_CPU / 1000);
+
+        // tumbler left floating in run position reads whatever pull the firmware applies
+        setPin(avr, 'C', MODE_TUMBLER, &tumblerLevel, (avr->data[PORTC_ADDRESS] >> MODE_TUMBLER) & 1);
+
+        portd = avr->data[PORTD_ADDRESS];
+        upRelay = (portd >> UP_SWITCH) & 1;
+        downRelay = (portd >> DOWN_SWITCH) & 1;
+        closedLoop = (avr->data[DDRB_ADDRESS] >> SPEED_REFERENCE) & 1;
+        if(upRelay || downRelay) {
+            if(closedLoop) {
+                target = FULL_SPEED * avr->data[OCR2_ADDRESS] / 255;
+            } else {
+                target = ((portd >> SPEED_SELECT) & 1) ? FULL_SPEED : SLOW_SPEED;
+            }
+            speed += (target - speed) * STEP_US / 1e6 / RAMP_TAU;
+        } else {
+            speed -= speed * STEP_US / 1e6 / COAST_TAU;
+        }
+        if(upRelay) {
+            direction = 1;
+        } else if(downRelay) {
+            direction = -1;
+        }
+        position += direction * speed * STEP_US / 1e6; // coasts on the way it went after the relay opens
+        magnet = position - (int64_t) position;
+        if(magnet < 0) {
+            magnet += 1;
+        }
+        if(countLevel && magnet < MAGNET_SHARE) {
+            pulsesDriven++;
+        }
+        setPin(avr, 'D', HALL_SENSE, &hallLevel, magnet >= MAGNET_SHARE);
+        setPin(avr, 'D', HALL_COUNT, &countLevel, magnet >= MAGNET_SHARE);
+        if(avr->data[TCNT0_ADDRESS] != lastCount) {
+            lastCount = avr->data[TCNT0_ADDRESS];
+            countChanges++;
+        }
+
+        if(OPERATOR_WORKING == operator && now >= wakeMs) {
+            operator = OPERATOR_HOLDING;
+            relaySeen = 0;
+            legStartMs = now;
+            if(LEG_TO_BOT == leg) {
+                setPin(avr, 'B', DOWN_BUTTON, &downLevel, 0);
+            } else {
+                setPin(avr, 'B', UP_BUTTON, &upLevel, 0);
+            }
+        } else if(OPERATOR_HOLDING == operator) {
+            uint8_t relay = (LEG_TO_BOT == leg) ? downRelay : upRelay;
+
+            if(relay) {
+                relaySeen = 1;
+            } else if(relaySeen) {
+                operator = OPERATOR_RELEASING;
+                wakeMs = now + randomMs(REACTION_MS);
+            } else if(now - legStartMs > LEG_TIMEOUT_MS) {
+                fprintf(stderr, "leg %d did not start within %d ms\n", leg, LEG_TIMEOUT_MS);
+                return 1;
+            }
+        } else if(OPERATOR_RELEASING == operator && now >= wakeMs) {
+            setPin(avr, 'B', UP_BUTTON, &upLevel, 1);
+            setPin(avr, 'B', DOWN_BUTTON, &downLevel, 1);
+            leg = (LEG_TO_BOT == leg) ? LEG_TO_MID : leg + 1;
+            operator = OPERATOR_WORKING;
+            wakeMs = now + randomMs(workMs[(leg + 2) % 3]); // work at the position just reached
+            if(readU32(stats + 2) >= cycles) {
+                break;
+            }
+        }
+    }
+
+    if(BENCH_STATS_VERSION != (stats[0] | (stats[1] << 8))) {
+        fprintf(stderr, "benchStats version %u at 0x%04" PRIx32 ", expected %u\n",
+                stats[0] | (stats[1] << 8), statsAddress, BENCH_STATS_VERSION);
+        return 1;
+    }
+
+    if(pulsesDriven && 0 == countChanges) {
+        fprintf(stderr, "warning: %" PRIu32 " falling edges driven on T0 but TCNT0 never moved, timer0 external clock is not simulated\n", pulsesDriven);
+    }
+
+    out = fopen(argv[3], "w");
+    if(!out) {
+        perror(argv[3]);
+        return 1;
+    }
+    fprintf(out, "{\n");
+    fprintf(out, "  \"firmware\": \"%s\",\n  \"label\": \"%s\",\n  \"seed\": %" PRIu32 ",\n", argv[1], label, firstSeed);
+    fprintf(out, "  \"simulated_ms\": %" PRIu32 ",\n", now);
+    fprintf(out, "  \"pulses_driven\": %" PRIu32 ",\n  \"t0_counting\": %s,\n", pulsesDriven, countChanges ? "true" : "false");
+    fprintf(out, "  \"cycles_per_hour\": %.1f,\n", readU32(stats + 6) ? 3600000.0 * readU32(stats + 2) / readU32(stats + 6) : 0.0);
+    writeTiming(out, "cycle", stats + 2, 0);
+    writeTiming(out, "leg_mid", stats + 18, 0);
+    writeTiming(out, "leg_top", stats + 34, 0);
+    writeTiming(out, "leg_bot", stats + 50, 0);
+    writeTiming(out, "blocked", stats + 66, 0);
+    writeTiming(out, "debounce", stats + 82, 1);
+    fprintf(out, "}\n");
+    fclose(out);
+
+    printf("%" PRIu32 " cycles, %.1f cycles per hour, results in %s\n", readU32(stats + 2),
+            readU32(stats + 6) ? 3600000.0 * readU32(stats + 2) / readU32(stats + 6) : 0.0, argv[3]);
+    avr_terminate(avr);
+    return 0;
+}
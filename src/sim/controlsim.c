@@ -0,0 +1,86 @@
+/*
+    Host simulation of the closed loop speed control in control.c
+
+    Runs the same control law at the same rate as the firmware against a
+    first order model of the VFD and pulley and prints the deceleration
+    profile as CSV on stdout, with a summary on stderr.
+
+    usage: controlsim [distance [distanceGain speedGain feedForward minSpeed maxSpeed]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "control.h"
+
+#define TIMEBASE_HZ 2000000UL   // timer1 at clk/8 on a 16MHz part
+#define CONTROL_RATE_HZ 200
+#define STEP_S 0.00005
+
+#define PLANT_MAX_SPEED 408.0   // pulses/s at full duty, matches the default feed forward
+#define PLANT_TAU 0.15          // drive ramp time constant while running, s
+#define PLANT_COAST_TAU 0.08    // time constant after the relay drops, s
+
+int main(int argc, char **argv) {
+    speed_control_t ctl = {DISTANCE_GAIN, SPEED_GAIN, FEED_FORWARD, MIN_SPEED, MAX_SPEED};
+    int32_t distance = 1000;
+    double t = 0, position = 0, speed = 0, nextControl = 0;
+    uint32_t lastFall = 0, period = 0, now, sinceEdge;
+    int32_t clicks = 0, remaining = distance;
+    uint8_t duty = 0, running = 1;
+    double arrival = 0;
+
+    if(argc > 1) {
+        distance = atol(argv[1]);
+        remaining = distance;
+    }
+    if(argc > 6) {
+        ctl.distanceGain = atoi(argv[2]);
+        ctl.speedGain = atoi(argv[3]);
+        ctl.feedForward = atoi(argv[4]);
+        ctl.minSpeed = atoi(argv[5]);
+        ctl.maxSpeed = atoi(argv[6]);
+    }
+
+    printf("ms,remaining,reference,measured,speed,duty\n");
+    while(running || speed > 0.5) {
+        now = (uint32_t) (t * TIMEBASE_HZ);
+        if(t >= nextControl) {
+            nextControl += 1.0 / CONTROL_RATE_HZ;
+            sinceEdge = now - lastFall;
+            if(running) {
+                uint32_t measured = (sinceEdge > period) ? sinceEdge : period;
+                uint16_t measuredSpeed = speedFromPeriod(measured, TIMEBASE_HZ);
+                duty = speedControl(&ctl, remaining, measuredSpeed);
+                printf("%.1f,%ld,%u,%u,%.1f,%u\n", t * 1000, (long) remaining,
+                        referenceSpeed(&ctl, remaining), measuredSpeed, speed, duty);
+            }
+        }
+
+        if(running) {
+            speed += (duty * PLANT_MAX_SPEED / 255.0 - speed) * STEP_S / PLANT_TAU;
+        } else {
+            speed -= speed * STEP_S / PLANT_COAST_TAU;
+        }
+        position += speed * STEP_S;
+        t += STEP_S;
+
+        if((int32_t) floor(position) > clicks) {
+            clicks++;
+            period = now - lastFall;
+            lastFall = now;
+            remaining = distance - clicks;
+            if(running && remaining <= 0) {
+                running = 0; //relay drops on the target pulse
+                arrival = t;
+            }
+        }
+        if(t > 600) {
+            fprintf(stderr, "target not reached in 600s\n");
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "distance %ld pulses, arrival %.3f s, overshoot %ld pulses\n",
+            (long) distance, arrival, (long) (clicks - distance));
+    return 0;
+}